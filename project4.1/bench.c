@@ -0,0 +1,444 @@
+/*********************************************************************
+* Benchmark harness for the master-worker queue.
+*
+* Usage: main --bench [-p list] [-c list] [-n list] [-w list] [-l list] [-a] <M>
+*   M     - numbers 0..M-1 produced per run
+*   -p    - master (producer) counts to sweep, e.g. 1,2,4
+*   -c    - worker (consumer) counts to sweep
+*   -n    - buffer sizes to sweep
+*   -w    - wait strategies to sweep: spin, sleep, block
+*   -l    - queue layouts to sweep: single (one shared buffer) or
+*           sharded (one buffer per NUMA node/socket, threads pinned;
+*           the N slots are split over the buffers, so N must be at
+*           least the number of groups)
+*   -a    - also pin threads to cores in the single layout
+*
+* Every run checks that each number 0..M-1 was consumed exactly once.
+* links
+* https://man7.org/linux/man-pages/man2/perf_event_open.2.html
+**********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "bench.h"
+#include "bqueue.h"
+#include "histogram.h"
+#include "shardq.h"
+#include "topology.h"
+
+#define MAX_SWEEP 16   // Most values accepted in one sweep list.
+#define CLAIM_BATCH 32 // Numbers a master claims from the shared counter at once.
+
+/* Hardware and software counters collected around each run. */
+enum {
+    COUNTER_CACHE_MISSES,
+    COUNTER_CACHE_REFS,
+    COUNTER_L1D_MISSES,
+    COUNTER_CONTEXT_SWITCHES,
+    NUM_COUNTERS
+};
+
+typedef struct {
+    int fd[NUM_COUNTERS]; // -1 when the counter is unavailable.
+} perf_counters_t;
+
+typedef enum {
+    LAYOUT_SINGLE,  // One buffer shared by every thread.
+    LAYOUT_SHARDED  // One buffer per CPU group, threads pinned to their group.
+} bench_layout_t;
+
+/* State shared by every thread of one run. */
+typedef struct {
+    bench_layout_t layout;
+    bqueue_t queue;         // LAYOUT_SINGLE
+    shardq_t shards;        // LAYOUT_SHARDED
+    int num_items;
+    int next_number __attribute__((aligned(64))); // Next number a master will produce.
+    unsigned char *seen;    // How many times each number was consumed.
+    int out_of_range;       // Consumed numbers outside 0..M-1.
+    pthread_barrier_t start;
+} bench_run_t;
+
+/* Per-thread state, merged by the main thread after the run. Padded so
+   threads never write to the same cache line. */
+typedef struct {
+    bench_run_t *run;
+    histogram_t *hist;    // Queue latency samples (workers only).
+    int cpu;              // CPU to pin to, or -1 to leave unpinned.
+    int shard;            // Local shard in LAYOUT_SHARDED.
+    uint64_t wait_cpu_ns; // Thread CPU time spent waiting on the queue.
+    uint64_t remote_gets; // Items taken from a remote shard.
+} __attribute__((aligned(64))) bench_thread_t;
+
+typedef struct {
+    int producers;
+    int consumers;
+    int buffer_size;
+    wait_strategy_t wait;
+    bench_layout_t layout;
+    int pin; // Pin threads even in LAYOUT_SINGLE.
+} bench_config_t;
+
+#ifdef __linux__
+/*
+* Open one counter for this process and all threads it creates afterwards.
+* input - type, config: perf event selector, user_only: exclude kernel time
+* output - file descriptor, or -1 if the counter is not available
+*/
+static int perf_open(uint32_t type, uint64_t config, int user_only) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.inherit = 1; // Fold worker and master threads into our count.
+    attr.exclude_kernel = user_only;
+    attr.exclude_hv = 1;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+static void perf_start(perf_counters_t *pc) {
+    for (int i = 0; i < NUM_COUNTERS; i++) pc->fd[i] = -1;
+#ifdef __linux__
+    pc->fd[COUNTER_CACHE_MISSES] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, 1);
+    pc->fd[COUNTER_CACHE_REFS] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES, 1);
+    pc->fd[COUNTER_L1D_MISSES] = perf_open(PERF_TYPE_HW_CACHE,
+            PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), 1);
+    pc->fd[COUNTER_CONTEXT_SWITCHES] = perf_open(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, 0);
+#endif
+}
+
+/*
+* Read and close the counters.
+* input - pc: counters from perf_start, values: output array
+* output - values[i] is the count, or -1 if the counter was unavailable
+*/
+static void perf_stop(perf_counters_t *pc, long long values[NUM_COUNTERS]) {
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        values[i] = -1;
+        if (pc->fd[i] < 0) continue;
+        long long count;
+        if (read(pc->fd[i], &count, sizeof(count)) == (ssize_t)sizeof(count)) values[i] = count;
+        close(pc->fd[i]);
+    }
+}
+
+/*
+* Claim up to CLAIM_BATCH units from a shared counter. Batching keeps the
+* counter's cache line from bouncing between sockets on every item.
+* input - counter: shared counter, limit: total units available, first: receives the first unit
+* output - number of units claimed, 0 once the counter is exhausted
+*/
+static int claim_batch(int *counter, int limit, int *first) {
+    int start = __atomic_fetch_add(counter, CLAIM_BATCH, __ATOMIC_RELAXED);
+    if (start >= limit) return 0;
+    *first = start;
+    return limit - start < CLAIM_BATCH ? limit - start : CLAIM_BATCH;
+}
+
+static void* bench_master(void *arg) {
+    bench_thread_t *t = arg;
+    bench_run_t *run = t->run;
+    int first, count;
+
+    if (t->cpu >= 0) topology_pin_cpu(t->cpu);
+    pthread_barrier_wait(&run->start);
+    while ((count = claim_batch(&run->next_number, run->num_items, &first)) > 0) {
+        for (int num = first; num < first + count; num++) {
+            bq_item_t item = { num, 0 };
+            if (run->layout == LAYOUT_SHARDED) shardq_put(&run->shards, t->shard, item, &t->wait_cpu_ns);
+            else bq_put(&run->queue, item, &t->wait_cpu_ns);
+        }
+    }
+    return NULL;
+}
+
+static void* bench_worker(void *arg) {
+    bench_thread_t *t = arg;
+    bench_run_t *run = t->run;
+    bq_item_t item;
+
+    if (t->cpu >= 0) topology_pin_cpu(t->cpu);
+    pthread_barrier_wait(&run->start);
+    // Drain until the main thread closes the queue after the masters finish,
+    // so a lost item shows up as missing instead of hanging the run.
+    for (;;) {
+        int got = run->layout == LAYOUT_SHARDED
+            ? shardq_get(&run->shards, t->shard, &item, &t->wait_cpu_ns, &t->remote_gets)
+            : bq_get(&run->queue, &item, &t->wait_cpu_ns);
+        if (got != 0) break;
+        hist_record(t->hist, monotonic_ns() - item.enqueue_ns);
+
+        if (item.num >= 0 && item.num < run->num_items) {
+            __atomic_fetch_add(&run->seen[item.num], 1, __ATOMIC_RELAXED);
+        } else {
+            __atomic_fetch_add(&run->out_of_range, 1, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+static uint64_t process_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void print_counter(long long value) {
+    if (value < 0) printf(" %10s", "n/a");
+    else printf(" %10lld", value);
+}
+
+/*
+* Run one configuration and print a result row.
+* input - cfg: thread counts, buffer size, wait strategy and layout,
+*         topo: CPU topology, num_items: M
+* output - 0 if every number was consumed exactly once, 1 otherwise
+*/
+static int bench_run(const bench_config_t *cfg, const topology_t *topo, int num_items) {
+    int total_threads = cfg->producers + cfg->consumers;
+    int pin = cfg->pin || cfg->layout == LAYOUT_SHARDED;
+    if (cfg->layout == LAYOUT_SHARDED && cfg->buffer_size < topo->num_groups) {
+        // N is split exactly over the shards, so each group needs at least one slot.
+        printf("%-7s %-5s %3d %3d %6d  skipped: N is below the %d CPU groups\n", "sharded",
+               wait_strategy_name(cfg->wait), cfg->producers, cfg->consumers, cfg->buffer_size, topo->num_groups);
+        return 0;
+    }
+    bench_run_t run;
+    memset(&run, 0, sizeof(run));
+    run.layout = cfg->layout;
+    run.num_items = num_items;
+    run.seen = calloc((size_t)num_items, 1);
+    bench_thread_t *threads = NULL;
+    if (posix_memalign((void **)&threads, 64, (size_t)total_threads * sizeof(bench_thread_t)) == 0) {
+        memset(threads, 0, (size_t)total_threads * sizeof(bench_thread_t));
+    }
+    pthread_t *tids = malloc((size_t)total_threads * sizeof(pthread_t));
+    histogram_t *latency = malloc(sizeof(histogram_t));
+    int queue_failed = cfg->layout == LAYOUT_SHARDED
+        ? shardq_init(&run.shards, topo, cfg->buffer_size, cfg->wait)
+        : bq_init(&run.queue, cfg->buffer_size, cfg->wait);
+    if (run.seen == NULL || threads == NULL || tids == NULL || latency == NULL || queue_failed) {
+        fprintf(stderr, "Failed to allocate benchmark state\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_barrier_init(&run.start, NULL, (unsigned)total_threads + 1);
+    hist_init(latency);
+
+    int slots_used[TOPO_MAX_GROUPS] = { 0 }; // Shared by masters and workers so they get distinct cores.
+    perf_counters_t pc;
+    perf_start(&pc);
+
+    for (int i = 0; i < total_threads; i++) {
+        int is_master = i < cfg->producers;
+        int role_index = is_master ? i : i - cfg->producers;
+        threads[i].run = &run;
+        threads[i].cpu = -1;
+        if (pin) threads[i].cpu = topology_place(topo, role_index, slots_used, &threads[i].shard);
+        if (!is_master) {
+            threads[i].hist = malloc(sizeof(histogram_t));
+            if (threads[i].hist == NULL) {
+                fprintf(stderr, "Failed to allocate histogram\n");
+                exit(EXIT_FAILURE);
+            }
+            hist_init(threads[i].hist);
+        }
+        if (pthread_create(&tids[i], NULL, is_master ? bench_master : bench_worker, &threads[i]) != 0) {
+            // The start barrier would never release; give up instead of hanging.
+            fprintf(stderr, "Failed to create %s thread %d\n", is_master ? "master" : "worker", role_index);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    pthread_barrier_wait(&run.start); // Release every thread at once.
+    uint64_t start_ns = monotonic_ns();
+    uint64_t start_cpu = process_cpu_ns();
+
+    // Masters first; once they are all done nothing more is coming, so close the queue.
+    for (int i = 0; i < cfg->producers; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    if (cfg->layout == LAYOUT_SHARDED) shardq_close(&run.shards);
+    else bq_close(&run.queue);
+
+    uint64_t wait_cpu_ns = 0, remote_gets = 0;
+    for (int i = 0; i < total_threads; i++) {
+        if (i >= cfg->producers) pthread_join(tids[i], NULL);
+        wait_cpu_ns += threads[i].wait_cpu_ns;
+        remote_gets += threads[i].remote_gets;
+        if (threads[i].hist) {
+            hist_merge(latency, threads[i].hist);
+            free(threads[i].hist);
+        }
+    }
+
+    uint64_t elapsed_ns = monotonic_ns() - start_ns;
+    uint64_t cpu_ns = process_cpu_ns() - start_cpu;
+    long long counters[NUM_COUNTERS];
+    perf_stop(&pc, counters);
+
+    int missing = 0, duplicated = 0;
+    for (int i = 0; i < num_items; i++) {
+        if (run.seen[i] == 0) missing++;
+        else if (run.seen[i] > 1) duplicated++;
+    }
+    int ok = missing == 0 && duplicated == 0 && run.out_of_range == 0;
+
+    double seconds = elapsed_ns / 1e9;
+    printf("%-7s %-5s %3d %3d %6d %12.0f %8llu %8llu %8llu %8llu %9llu %9.1f %9.1f",
+           cfg->layout == LAYOUT_SHARDED ? "sharded" : (pin ? "pinned" : "single"),
+           wait_strategy_name(cfg->wait), cfg->producers, cfg->consumers, cfg->buffer_size,
+           seconds > 0 ? num_items / seconds : 0.0,
+           (unsigned long long)hist_mean(latency),
+           (unsigned long long)hist_percentile(latency, 50.0),
+           (unsigned long long)hist_percentile(latency, 99.0),
+           (unsigned long long)hist_percentile(latency, 99.9),
+           (unsigned long long)latency->max,
+           wait_cpu_ns / 1e6, cpu_ns / 1e6);
+    for (int i = 0; i < NUM_COUNTERS; i++) print_counter(counters[i]);
+    if (cfg->layout == LAYOUT_SHARDED) printf(" %7.1f", 100.0 * (double)(num_items - (long long)remote_gets) / num_items);
+    else printf(" %7s", "-");
+    if (ok) printf("  ok\n");
+    else printf("  FAIL(missing=%d dup=%d bad=%d)\n", missing, duplicated, run.out_of_range);
+
+    pthread_barrier_destroy(&run.start);
+    if (cfg->layout == LAYOUT_SHARDED) shardq_destroy(&run.shards);
+    else bq_destroy(&run.queue);
+    free(latency);
+    free(tids);
+    free(threads);
+    free(run.seen);
+    return ok ? 0 : 1;
+}
+
+/*
+* Parse a comma separated list of positive integers.
+* input - s: the list, out: destination, max: capacity of out
+* output - number of values parsed, or -1 on a malformed list
+*/
+static int parse_int_list(const char *s, int *out, int max) {
+    int n = 0;
+    while (*s) {
+        char *end;
+        long v = strtol(s, &end, 10);
+        if (end == s || v <= 0 || v > 1000000 || n == max) return -1;
+        out[n++] = (int)v;
+        if (*end == ',') end++;
+        else if (*end != '\0') return -1;
+        s = end;
+    }
+    return n;
+}
+
+/*
+* Parse a comma separated list of wait strategy names.
+* input - s: the list, out: destination, max: capacity of out
+* output - number of strategies parsed, or -1 on an unknown name
+*/
+static int parse_wait_list(const char *s, wait_strategy_t *out, int max) {
+    char copy[256];
+    int n = 0;
+    snprintf(copy, sizeof(copy), "%s", s);
+    for (char *tok = strtok(copy, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        if (n == max || wait_strategy_parse(tok, &out[n]) != 0) return -1;
+        n++;
+    }
+    return n;
+}
+
+/*
+* Parse a comma separated list of queue layouts.
+* input - s: the list, out: destination, max: capacity of out
+* output - number of layouts parsed, or -1 on an unknown name
+*/
+static int parse_layout_list(const char *s, bench_layout_t *out, int max) {
+    char copy[256];
+    int n = 0;
+    snprintf(copy, sizeof(copy), "%s", s);
+    for (char *tok = strtok(copy, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        if (n == max) return -1;
+        if (strcmp(tok, "single") == 0) out[n++] = LAYOUT_SINGLE;
+        else if (strcmp(tok, "sharded") == 0) out[n++] = LAYOUT_SHARDED;
+        else return -1;
+    }
+    return n;
+}
+
+static void bench_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s --bench [-p list] [-c list] [-n list] [-w spin,sleep,block] "
+            "[-l single,sharded] [-a] <M>\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+/*
+* Entry point for "main --bench ...".
+* input - argc, argv: the full command line, argv[1] is "--bench"
+* output - 0 if every run passed the exactly-once check
+*/
+int bench_main(int argc, char *argv[]) {
+    int producers[MAX_SWEEP] = { 1, 2, 4 };
+    int consumers[MAX_SWEEP] = { 1, 2, 4 };
+    int sizes[MAX_SWEEP] = { 1, 64, 1000 };
+    wait_strategy_t waits[MAX_SWEEP] = { WAIT_SPIN, WAIT_SLEEP, WAIT_BLOCK };
+    bench_layout_t layouts[MAX_SWEEP] = { LAYOUT_SINGLE };
+    int num_producers = 3, num_consumers = 3, num_sizes = 3, num_waits = 3, num_layouts = 1;
+    int pin = 0, opt;
+
+    optind = 2; // Skip the program name and "--bench".
+    while ((opt = getopt(argc, argv, "p:c:n:w:l:a")) != -1) {
+        switch (opt) {
+        case 'p': num_producers = parse_int_list(optarg, producers, MAX_SWEEP); break;
+        case 'c': num_consumers = parse_int_list(optarg, consumers, MAX_SWEEP); break;
+        case 'n': num_sizes = parse_int_list(optarg, sizes, MAX_SWEEP); break;
+        case 'w': num_waits = parse_wait_list(optarg, waits, MAX_SWEEP); break;
+        case 'l': num_layouts = parse_layout_list(optarg, layouts, MAX_SWEEP); break;
+        case 'a': pin = 1; break;
+        default: bench_usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || num_producers < 0 || num_consumers < 0 || num_sizes < 0 || num_waits < 0 || num_layouts < 0) {
+        bench_usage(argv[0]);
+    }
+    int num_items = atoi(argv[optind]);
+    if (num_items <= 0) bench_usage(argv[0]);
+
+    topology_t *topo = malloc(sizeof(topology_t));
+    if (topo == NULL || topology_read(topo) != 0) {
+        fprintf(stderr, "Failed to read CPU topology\n");
+        exit(EXIT_FAILURE);
+    }
+    printf("# %d usable CPUs in %d group(s)\n", topo->num_cpus, topo->num_groups);
+
+    printf("%-7s %-5s %3s %3s %6s %12s %8s %8s %8s %8s %9s %9s %9s %10s %10s %10s %10s %7s  %s\n",
+           "layout", "wait", "P", "C", "N", "items/s", "mean(ns)", "p50(ns)", "p99(ns)", "p99.9", "max(ns)",
+           "wait(ms)", "cpu(ms)", "cache-miss", "cache-ref", "L1d-miss", "ctx-sw", "local%", "check");
+
+    int failures = 0;
+    for (int l = 0; l < num_layouts; l++) {
+        for (int w = 0; w < num_waits; w++) {
+            for (int s = 0; s < num_sizes; s++) {
+                for (int p = 0; p < num_producers; p++) {
+                    for (int c = 0; c < num_consumers; c++) {
+                        bench_config_t cfg = { producers[p], consumers[c], sizes[s], waits[w], layouts[l], pin };
+                        failures += bench_run(&cfg, topo, num_items);
+                        fflush(stdout);
+                    }
+                }
+            }
+        }
+    }
+    free(topo);
+    return failures ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,14 @@
+/*********************************************************************
+* Benchmark mode for the master-worker program.
+*
+* Sweeps master/worker counts, buffer sizes and wait strategies, and for
+* each combination reports throughput, queue latency percentiles, CPU time
+* spent waiting and (when perf_event_open is usable) cache counters.
+**********************************************************************/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+int bench_main(int argc, char *argv[]);
+
+#endif
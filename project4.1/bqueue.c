@@ -0,0 +1,320 @@
+/*********************************************************************
+* Bounded FIFO queue with selectable wait strategies.
+* See bqueue.h for the interface.
+* links
+* https://www.baeldung.com/cs/os-busy-waiting
+* https://man7.org/linux/man-pages/man3/pthread_cond_wait.3p.html
+**********************************************************************/
+
+#include <sched.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bqueue.h"
+
+#define SPIN_LIMIT 1000 // Pause iterations before a spinner yields its CPU.
+
+/*
+* Hint to the CPU that we are in a spin loop.
+* input - none
+* output - none
+*/
+static void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/*
+* Wait once for the queue state to change. Called with q->lock held and
+* returns with it held again. Spinning reads count without the lock so the
+* spinner cannot starve the thread it is waiting for, and yields after
+* SPIN_LIMIT tries in case that thread needs this CPU. Closing the queue
+* also ends the wait.
+* input - q: the queue, cond: condition variable to block on,
+*         blocked_count: the count value that means "keep waiting"
+* output - none
+*/
+static void bq_wait(bqueue_t *q, pthread_cond_t *cond, int blocked_count) {
+    switch (q->wait) {
+    case WAIT_SPIN:
+        pthread_mutex_unlock(&q->lock);
+        for (int spins = 0; __atomic_load_n(&q->count, __ATOMIC_RELAXED) == blocked_count &&
+                            !__atomic_load_n(&q->closed, __ATOMIC_RELAXED); ) {
+            wait_strategy_pause(WAIT_SPIN, &spins);
+        }
+        pthread_mutex_lock(&q->lock);
+        break;
+    case WAIT_SLEEP:
+        pthread_mutex_unlock(&q->lock);
+        usleep(10);
+        pthread_mutex_lock(&q->lock);
+        break;
+    case WAIT_BLOCK:
+        pthread_cond_wait(cond, &q->lock);
+        break;
+    }
+}
+
+/*
+* input - q: queue to set up, capacity: number of slots, wait: wait strategy
+* output - 0 on success, -1 if the slots could not be allocated
+*/
+int bq_init(bqueue_t *q, int capacity, wait_strategy_t wait) {
+    bq_item_t *slots = malloc((size_t)capacity * sizeof(bq_item_t));
+    if (slots == NULL) return -1;
+    bq_init_slots(q, slots, capacity, wait);
+    q->owns_slots = 1;
+    return 0;
+}
+
+/*
+* Set up a queue over slots owned by the caller, e.g. memory placed on a
+* particular NUMA node. bq_destroy leaves the slots alone.
+* input - q: queue to set up, slots: capacity entries, capacity: number of slots,
+*         wait: wait strategy
+* output - none
+*/
+void bq_init_slots(bqueue_t *q, bq_item_t *slots, int capacity, wait_strategy_t wait) {
+    memset(q, 0, sizeof(*q));
+    q->slots = slots;
+    q->capacity = capacity;
+    q->wait = wait;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+}
+
+void bq_destroy(bqueue_t *q) {
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+    pthread_mutex_destroy(&q->lock);
+    if (q->owns_slots) free(q->slots);
+    q->slots = NULL;
+}
+
+/*
+* Append an item. Called with q->lock held and a free slot.
+* input - q: the queue, item: the item to insert
+* output - none
+*/
+static void bq_push(bqueue_t *q, bq_item_t item) {
+    item.enqueue_ns = monotonic_ns();
+    q->slots[q->tail] = item;
+    q->tail = (q->tail + 1) % q->capacity;
+    __atomic_store_n(&q->count, q->count + 1, __ATOMIC_RELAXED); // Spinners read count unlocked.
+    q->stats.puts++;
+    q->stats.depth_sum += (uint64_t)q->count;
+    if (q->count > q->stats.max_depth) q->stats.max_depth = q->count;
+    if (q->wait == WAIT_BLOCK) pthread_cond_signal(&q->not_empty);
+}
+
+/*
+* Remove the oldest item. Called with q->lock held and a non-empty queue.
+* input - q: the queue
+* output - the removed item
+*/
+static bq_item_t bq_pop(bqueue_t *q) {
+    bq_item_t item = q->slots[q->head];
+    q->head = (q->head + 1) % q->capacity;
+    __atomic_store_n(&q->count, q->count - 1, __ATOMIC_RELAXED);
+    q->stats.gets++;
+    if (q->wait == WAIT_BLOCK) pthread_cond_signal(&q->not_full);
+    return item;
+}
+
+/*
+* Insert an item, waiting while the queue is full. The item is stamped
+* with its enqueue time once a slot is free.
+* input - q: the queue, item: the item to insert,
+*         wait_cpu_ns: if not NULL, thread CPU time spent waiting is added here
+* output - 0 if inserted, -1 if the queue is closed
+*/
+int bq_put(bqueue_t *q, bq_item_t item, uint64_t *wait_cpu_ns) {
+    pthread_mutex_lock(&q->lock);
+    if (q->count == q->capacity && !q->closed) {
+        uint64_t start = wait_cpu_ns ? thread_cpu_ns() : 0;
+        uint64_t stall_start = monotonic_ns();
+        q->stats.putters_waiting++;
+        while (q->count == q->capacity && !q->closed) {
+            bq_wait(q, &q->not_full, q->capacity);
+        }
+        q->stats.putters_waiting--;
+        q->stats.full_stalls++;
+        q->stats.full_stall_ns += monotonic_ns() - stall_start;
+        if (wait_cpu_ns) *wait_cpu_ns += thread_cpu_ns() - start;
+    }
+
+    if (q->closed) {
+        pthread_mutex_unlock(&q->lock);
+        return -1;
+    }
+    bq_push(q, item);
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+/*
+* Remove the oldest item, waiting while the queue is empty. Items left in
+* a closed queue are still handed out.
+* input - q: the queue, item: receives the removed item,
+*         wait_cpu_ns: if not NULL, thread CPU time spent waiting is added here
+* output - 0 if an item was removed, -1 if the queue is closed and drained
+*/
+int bq_get(bqueue_t *q, bq_item_t *item, uint64_t *wait_cpu_ns) {
+    pthread_mutex_lock(&q->lock);
+    if (q->count == 0 && !q->closed) {
+        uint64_t start = wait_cpu_ns ? thread_cpu_ns() : 0;
+        uint64_t stall_start = monotonic_ns();
+        q->stats.getters_waiting++;
+        while (q->count == 0 && !q->closed) {
+            bq_wait(q, &q->not_empty, 0);
+        }
+        q->stats.getters_waiting--;
+        q->stats.empty_stalls++;
+        q->stats.empty_stall_ns += monotonic_ns() - stall_start;
+        if (wait_cpu_ns) *wait_cpu_ns += thread_cpu_ns() - start;
+    }
+
+    if (q->count == 0) { // Closed and nothing left to drain.
+        pthread_mutex_unlock(&q->lock);
+        return -1;
+    }
+    *item = bq_pop(q);
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+/*
+* Insert an item only if there is room right now.
+* input - q: the queue, item: the item to insert
+* output - 0 if inserted, -1 if the queue was full or closed
+*/
+int bq_try_put(bqueue_t *q, bq_item_t item) {
+    if (__atomic_load_n(&q->count, __ATOMIC_RELAXED) == q->capacity) return -1; // Skip the lock when clearly full.
+    pthread_mutex_lock(&q->lock);
+    int ok = q->count < q->capacity && !q->closed;
+    if (ok) bq_push(q, item);
+    pthread_mutex_unlock(&q->lock);
+    return ok ? 0 : -1;
+}
+
+/*
+* Remove the oldest item only if one is available right now.
+* input - q: the queue, item: receives the removed item
+* output - 0 if an item was removed, -1 if the queue was empty
+*/
+int bq_try_get(bqueue_t *q, bq_item_t *item) {
+    if (__atomic_load_n(&q->count, __ATOMIC_RELAXED) == 0) return -1; // Skip the lock when clearly empty.
+    pthread_mutex_lock(&q->lock);
+    int ok = q->count > 0;
+    if (ok) *item = bq_pop(q);
+    pthread_mutex_unlock(&q->lock);
+    return ok ? 0 : -1;
+}
+
+/*
+* Block until the queue may have an item or the timeout passes. Used by
+* callers that poll several queues but still want to sleep between polls.
+* input - q: the queue, timeout_ns: longest time to wait
+* output - none; the caller must re-check the queue
+*/
+void bq_wait_nonempty(bqueue_t *q, uint64_t timeout_ns) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    uint64_t nsec = (uint64_t)deadline.tv_nsec + timeout_ns;
+    deadline.tv_sec += (time_t)(nsec / 1000000000u);
+    deadline.tv_nsec = (long)(nsec % 1000000000u);
+
+    pthread_mutex_lock(&q->lock);
+    int rc = 0;
+    while (q->count == 0 && !q->closed && rc != ETIMEDOUT) {
+        rc = pthread_cond_timedwait(&q->not_empty, &q->lock, &deadline);
+    }
+    pthread_mutex_unlock(&q->lock);
+}
+
+/*
+* Close the queue. Waiting putters return -1, and getters drain the
+* remaining items before they too get -1.
+* input - q: the queue
+* output - none
+*/
+void bq_close(bqueue_t *q) {
+    pthread_mutex_lock(&q->lock);
+    __atomic_store_n(&q->closed, 1, __ATOMIC_RELAXED); // Spinners read closed unlocked.
+    pthread_cond_broadcast(&q->not_full);
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/*
+* Take a consistent snapshot of the queue counters.
+* input - q: the queue, stats: receives the counters,
+*         depth: if not NULL, receives the current number of items
+* output - none
+*/
+void bq_stats(bqueue_t *q, bq_stats_t *stats, int *depth) {
+    pthread_mutex_lock(&q->lock);
+    *stats = q->stats;
+    if (depth) *depth = q->count;
+    pthread_mutex_unlock(&q->lock);
+}
+
+const char *wait_strategy_name(wait_strategy_t wait) {
+    switch (wait) {
+    case WAIT_SPIN: return "spin";
+    case WAIT_SLEEP: return "sleep";
+    case WAIT_BLOCK: return "block";
+    }
+    return "?";
+}
+
+/*
+* input - name: "spin", "sleep" or "block", wait: where to store the result
+* output - 0 on success, -1 if the name is unknown
+*/
+int wait_strategy_parse(const char *name, wait_strategy_t *wait) {
+    if (strcmp(name, "spin") == 0) *wait = WAIT_SPIN;
+    else if (strcmp(name, "sleep") == 0) *wait = WAIT_SLEEP;
+    else if (strcmp(name, "block") == 0) *wait = WAIT_BLOCK;
+    else return -1;
+    return 0;
+}
+
+/*
+* Pause between polls of a queue that is not ready. Blocking callers must
+* sleep on a condition variable themselves, so WAIT_BLOCK does nothing here.
+* input - wait: the strategy, spins: poll counter kept by the caller, start at 0
+* output - none
+*/
+void wait_strategy_pause(wait_strategy_t wait, int *spins) {
+    switch (wait) {
+    case WAIT_SPIN:
+        if ((*spins)++ < SPIN_LIMIT) cpu_relax();
+        else sched_yield();
+        break;
+    case WAIT_SLEEP:
+        usleep(10);
+        break;
+    case WAIT_BLOCK:
+        break;
+    }
+}
+
+uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
@@ -0,0 +1,75 @@
+/*********************************************************************
+* Bounded FIFO queue shared by master (producer) and worker (consumer)
+* threads. The ring buffer is protected by a mutex; what a thread does
+* while the queue is full or empty is picked by the wait strategy.
+*
+* Closing a queue makes further puts fail and lets getters drain what is
+* left; once a closed queue is empty bq_get returns -1, so consumers know
+* exactly when to stop.
+**********************************************************************/
+
+#ifndef BQUEUE_H
+#define BQUEUE_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+typedef enum {
+    WAIT_SPIN,  // Drop the lock and retry immediately.
+    WAIT_SLEEP, // Drop the lock and usleep(10), like the original busy wait.
+    WAIT_BLOCK  // Sleep on a condition variable until signalled.
+} wait_strategy_t;
+
+typedef struct {
+    int num;             // The number produced.
+    uint64_t enqueue_ns; // Monotonic time the item entered the queue.
+} bq_item_t;
+
+/* Counters kept under the queue lock, read with bq_stats(). */
+typedef struct {
+    uint64_t puts;           // Items inserted.
+    uint64_t gets;           // Items removed.
+    uint64_t full_stalls;    // Puts that had to wait for space (backpressure).
+    uint64_t full_stall_ns;  // Wall time those puts spent waiting.
+    uint64_t empty_stalls;   // Gets that had to wait for an item.
+    uint64_t empty_stall_ns; // Wall time those gets spent waiting.
+    uint64_t depth_sum;      // Sum of the depth after each put, for the mean depth.
+    int max_depth;           // Deepest the queue has been.
+    int putters_waiting;     // Threads blocked in bq_put right now.
+    int getters_waiting;     // Threads blocked in bq_get right now.
+} bq_stats_t;
+
+typedef struct {
+    bq_item_t *slots;
+    int owns_slots; // bq_init allocated slots, so bq_destroy frees them.
+    int capacity;
+    int head;  // Next slot to read.
+    int tail;  // Next slot to write.
+    int count; // Items currently in the queue.
+    int closed; // Set by bq_close(); no more puts are accepted.
+    wait_strategy_t wait;
+    bq_stats_t stats;
+    pthread_mutex_t lock;
+    pthread_cond_t not_full;
+    pthread_cond_t not_empty;
+} bqueue_t;
+
+int bq_init(bqueue_t *q, int capacity, wait_strategy_t wait);
+void bq_init_slots(bqueue_t *q, bq_item_t *slots, int capacity, wait_strategy_t wait);
+void bq_destroy(bqueue_t *q);
+int bq_put(bqueue_t *q, bq_item_t item, uint64_t *wait_cpu_ns);
+int bq_get(bqueue_t *q, bq_item_t *item, uint64_t *wait_cpu_ns);
+int bq_try_put(bqueue_t *q, bq_item_t item);
+int bq_try_get(bqueue_t *q, bq_item_t *item);
+void bq_wait_nonempty(bqueue_t *q, uint64_t timeout_ns);
+void bq_close(bqueue_t *q);
+void bq_stats(bqueue_t *q, bq_stats_t *stats, int *depth);
+
+const char *wait_strategy_name(wait_strategy_t wait);
+int wait_strategy_parse(const char *name, wait_strategy_t *wait);
+void wait_strategy_pause(wait_strategy_t wait, int *spins);
+
+uint64_t monotonic_ns(void);
+uint64_t thread_cpu_ns(void);
+
+#endif
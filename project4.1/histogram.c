@@ -0,0 +1,90 @@
+/*********************************************************************
+* Log-linear latency histogram used by the benchmark harness.
+* See histogram.h for the bucket layout.
+* links
+* https://github.com/HdrHistogram/HdrHistogram_c
+**********************************************************************/
+
+#include <string.h>
+
+#include "histogram.h"
+
+#define HIST_LIMIT ((uint64_t)1 << HIST_MAX_BITS)
+
+/*
+* Map a value to its bucket.
+* input - value: the value to record
+* output - index into counts[]
+*/
+static int hist_index(uint64_t value) {
+    if (value >= HIST_LIMIT) value = HIST_LIMIT - 1;
+    if (value < 2 * HIST_SUB_COUNT) return (int)value; // Exact buckets for small values.
+
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - HIST_SUB_BITS;
+    // (value >> shift) lies in [HIST_SUB_COUNT, 2 * HIST_SUB_COUNT), so ranges line up back to back.
+    return shift * HIST_SUB_COUNT + (int)(value >> shift);
+}
+
+/*
+* Map a bucket back to the highest value it can hold.
+* input - index: bucket index
+* output - the largest value that lands in that bucket
+*/
+static uint64_t hist_value(int index) {
+    if (index < 2 * HIST_SUB_COUNT) return (uint64_t)index;
+
+    int shift = index / HIST_SUB_COUNT - 1;
+    uint64_t sub = (uint64_t)(index - shift * HIST_SUB_COUNT);
+    return ((sub + 1) << shift) - 1;
+}
+
+void hist_init(histogram_t *h) {
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+void hist_record(histogram_t *h, uint64_t value) {
+    h->counts[hist_index(value)]++;
+    h->total++;
+    h->sum += value;
+    if (value < h->min) h->min = value;
+    if (value > h->max) h->max = value;
+}
+
+void hist_merge(histogram_t *dst, const histogram_t *src) {
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->total += src->total;
+    dst->sum += src->sum;
+    if (src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+}
+
+/*
+* Find the value at a given percentile.
+* input - h: the histogram, percentile: 0 to 100
+* output - highest equivalent value of the bucket holding that percentile, 0 if empty
+*/
+uint64_t hist_percentile(const histogram_t *h, double percentile) {
+    if (h->total == 0) return 0;
+
+    uint64_t target = (uint64_t)(percentile / 100.0 * (double)h->total + 0.5);
+    if (target < 1) target = 1;
+    if (target > h->total) target = h->total;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= target) {
+            uint64_t value = hist_value(i);
+            return value > h->max ? h->max : value; // Never report more than was recorded.
+        }
+    }
+    return h->max;
+}
+
+uint64_t hist_mean(const histogram_t *h) {
+    return h->total ? h->sum / h->total : 0;
+}
@@ -0,0 +1,33 @@
+/*********************************************************************
+* Log-linear latency histogram in the style of HdrHistogram.
+*
+* Values below 2 * HIST_SUB_COUNT are recorded exactly. Above that every
+* power-of-two range is split into HIST_SUB_COUNT equal buckets, so the
+* relative error of a reported percentile stays under 1%.
+**********************************************************************/
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+#define HIST_SUB_BITS 7                     // log2 of sub-buckets per power of two
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS 40                    // values are clamped below 2^40 ns (~18 minutes)
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total; // Number of recorded values.
+    uint64_t min;   // Smallest recorded value.
+    uint64_t max;   // Largest recorded value.
+    uint64_t sum;   // Sum of recorded values, used for the mean.
+} histogram_t;
+
+void hist_init(histogram_t *h);
+void hist_record(histogram_t *h, uint64_t value);
+void hist_merge(histogram_t *dst, const histogram_t *src);
+uint64_t hist_percentile(const histogram_t *h, double percentile);
+uint64_t hist_mean(const histogram_t *h);
+
+#endif
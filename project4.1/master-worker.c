@@ -13,17 +13,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <string.h>
 #include <unistd.h>
 
+#include "bench.h"
+#include "pipeline.h"
+#include "pipeline_demo.h"
+
 #define MAX_BUFFER_SIZE 1000
 
-int* buffer; // Pointer for dynamic allocation
+pipeline_t *pipeline; // The buffer plus the worker threads that drain it.
 int buffer_size;               
 int num_to_produce;            
-int produced_count = 0; // Counting item produced and placed in the buffer.
-int consumed_count = 0;        // Counting item consumed and removed from the buffer.
 int next_number_to_produce = 0;// The next number to be produced by the master threads.
-int next_number_to_consume = 0;// The next number to be consumed by the worker threads from the buffer.
 
 /*
 * Print the number produced and the master thread id.
@@ -50,65 +52,42 @@ void print_consumed(int num, int thread_id) {
 * Output:
 *   None, function returns NULL after completing its execution.
 * 
-*   This function inserts numbers into a shared buffer.
-*   It implements a busy waiting mechanism to handle full buffer conditions and 
-*   stops producing when all numbers are produced.
+*   This function inserts numbers into the shared buffer.
+*   Each number is claimed atomically so no two masters produce the same one,
+*   and the put waits while the buffer is full. It stops once all numbers are claimed.
 */
 void* master_thread(void *arg) {
     int thread_id = *(int *)arg;
-    while (1) {
-        // Busy wait for buffer space. This loop goes until space is available.
-        while (produced_count - consumed_count >= buffer_size) {
-            usleep(10); // Sleep to reduce CPU usage during the wait. This was not mentioned in our reading however, 
-            //There's literally no way of around this unless we continuously checking a condition in a loop, but that will consume a lot of CPU resources.
-        }
-
-        // Breaks the loop if all numbers have been produced.
-        if (next_number_to_produce >= num_to_produce) break;
-
-        int num = next_number_to_produce; // Initialize 'num' with the current number to be produced. 
-        buffer[num % buffer_size] = num; // Assign 'num' to buffer at index. Alternative to this logic would be Busy Waiting with Status Flags. Which would be very tedious.
-        next_number_to_produce++; 
-        produced_count++;
-        
-        // Logs the production of the number.
+    int num;
+    while ((num = __atomic_fetch_add(&next_number_to_produce, 1, __ATOMIC_RELAXED)) < num_to_produce) {
+        // Logs the production first so it always comes before the matching "Consumed" line.
         print_produced(num, thread_id);
+
+        // Waits (usleep busy wait) while the buffer is full. Fails only if the buffer was closed early.
+        if (pipeline_put(pipeline, num, NULL) != 0) break;
     }
     return NULL;
 }
 
 /*
 * Input:
-*   arg - void pointer to thread specific data (here, it's used for thread ID)
+*   arg - unused, thread_id - id of the worker thread, num - number taken from the buffer,
+*   out - unused, there is no stage after the workers
 *
 * Output:
-*   None, function returns NULL after all numbers are consumed or the loop is explicitly broken.
+*   0, the number is not passed on.
 * 
 * Description:
-*   This function removes numbers from a shared buffer.
-*   It implements a busy waiting mechanism to handle empty buffer conditions.
+*   Called by each worker thread for every number it removes from the buffer.
+*   The workers exit once the buffer is closed and empty, so there is no
+*   counter to race on.
 */
-void* worker_thread(void *arg) {
-    int thread_id = *(int *)arg;
-    while (1) {
-        // Busy wait for items to consume. This loop goes until there are items.
-        while (produced_count <= consumed_count) {
-            usleep(10); // Sleep to reduce CPU usage during the wait. 
-            if (consumed_count >= num_to_produce) return NULL; // Breaks loop and exits if all produced items have been consumed.
-        }
-
-        // Consume the next available number from the buffer.
-        int num = buffer[next_number_to_consume % buffer_size];
-        next_number_to_consume++;
-        consumed_count++;
-
-        // Logs the consumption of the number.
-        print_consumed(num, thread_id);
-
-        // Breaks loop and exits if all produced items have been consumed.
-        if (consumed_count >= num_to_produce) break;
-    }
-    return NULL;
+int worker_consume(void *arg, int thread_id, int num, int *out) {
+    (void)arg;
+    (void)out;
+    // Logs the consumption of the number.
+    print_consumed(num, thread_id);
+    return 0;
 }
 
 /*
@@ -118,9 +97,18 @@ void* worker_thread(void *arg) {
 * output - returns 0 In success 
 */
 int main(int argc, char *argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "--bench") == 0) {
+        return bench_main(argc, argv); // Benchmark sweep instead of the normal run.
+    }
+    if (argc >= 2 && strcmp(argv[1], "--pipeline") == 0) {
+        return pipeline_demo_main(argc, argv); // Multi-stage pipeline run.
+    }
+
     //All given to us in the skeleton code.
     if (argc != 5) {
         fprintf(stderr, "Usage: %s <M> <N> <C> <P>\n", argv[0]);
+        fprintf(stderr, "       %s --bench [-p list] [-c list] [-n list] [-w list] [-l list] [-a] <M>\n", argv[0]);
+        fprintf(stderr, "       %s --pipeline [-w wait] [-i ms] <M> <N> <P> <workers[:work]>...\n", argv[0]);
         exit(EXIT_FAILURE);
     }
 
@@ -129,21 +117,27 @@ int main(int argc, char *argv[]) {
     int num_workers = atoi(argv[3]);
     int num_masters = atoi(argv[4]);
 
+    if (buffer_size < 1 || num_workers < 1 || num_masters < 1) {
+        fprintf(stderr, "Error: N, C and P must be at least 1\n");
+        exit(EXIT_FAILURE);
+    }
+
     if (buffer_size > MAX_BUFFER_SIZE) {
         fprintf(stderr, "Error: Buffer size exceeds maximum allowed size of %d\n", MAX_BUFFER_SIZE);
         exit(EXIT_FAILURE);
     }
 
-    buffer = (int*)malloc(buffer_size * sizeof(int)); // Allocate memory for the buffer
-    if (buffer == NULL) {
+    // A one-stage pipeline: the masters feed the buffer and the workers drain it.
+    // WAIT_SLEEP keeps the usleep busy wait of the original version.
+    pipeline_stage_t workers = { "workers", num_workers, worker_consume, NULL };
+    pipeline = pipeline_create(&workers, 1, buffer_size, WAIT_SLEEP); // Also creates the worker threads
+    if (pipeline == NULL) {
         fprintf(stderr, "Failed to allocate memory for buffer\n");
         exit(EXIT_FAILURE);
     }
 
     pthread_t master_threads[num_masters];
-    pthread_t worker_threads[num_workers];
     int master_ids[num_masters];
-    int worker_ids[num_workers];
 
     // Create master threads
     for (int i = 0; i < num_masters; i++) {
@@ -152,24 +146,18 @@ int main(int argc, char *argv[]) {
 
     }
 
-    // Create worker threads
-    for (int i = 0; i < num_workers; i++) {
-        worker_ids[i] = i; 
-        pthread_create(&worker_threads[i], NULL, worker_thread, &worker_ids[i]); // Create a worker thread that runs worker_thread function
-
-    }
-
     // Wait for all master threads to complete
     for (int i = 0; i < num_masters; i++) {
         pthread_join(master_threads[i], NULL); 
     }
 
+    // No more numbers are coming: close the buffer so workers exit once it is empty.
+    pipeline_close(pipeline);
+
     // Wait for all worker threads to complete
-    for (int i = 0; i < num_workers; i++) {
-        pthread_join(worker_threads[i], NULL); 
-    }
+    pipeline_join(pipeline);
 
-    free(buffer); // Free the dynamically allocated buffer memory
+    pipeline_destroy(pipeline); // Free the buffer memory
 
     return 0; // Return success
 }
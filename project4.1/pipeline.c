@@ -0,0 +1,278 @@
+/*********************************************************************
+* Multi-stage master-worker pipeline with bounded queues between stages.
+* See pipeline.h for the shutdown rules.
+**********************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "pipeline.h"
+
+typedef struct {
+    pipeline_t *p;
+    int stage; // Index of the stage this worker belongs to.
+    int id;    // Worker number within the stage.
+} stage_worker_t;
+
+typedef struct {
+    pipeline_stage_t spec;
+    bqueue_t queue;          // This stage's input queue.
+    int active;              // Workers still running; the last one closes the next queue.
+    uint64_t busy_ns;        // Wall time workers spent inside spec.fn.
+    pthread_t *threads;
+    stage_worker_t *workers;
+} stage_t;
+
+struct pipeline {
+    stage_t *stages;
+    int num_stages;
+    uint64_t start_ns; // When the workers were started, for utilization.
+
+    // Optional monitor thread printing pipeline_report() periodically.
+    int monitoring;
+    int stop_monitor;
+    int monitor_interval_ms;
+    FILE *monitor_out;
+    pthread_t monitor;
+    pthread_mutex_t monitor_lock;
+    pthread_cond_t monitor_cond;
+};
+
+/*
+* Worker loop: take from this stage's queue until it is closed and
+* drained, pass results to the next stage, then close the next stage's
+* queue if this was the stage's last running worker.
+* input - arg: the worker's stage_worker_t
+* output - NULL
+*/
+static void* stage_worker(void *arg) {
+    stage_worker_t *w = arg;
+    pipeline_t *p = w->p;
+    stage_t *st = &p->stages[w->stage];
+    stage_t *next = w->stage + 1 < p->num_stages ? &p->stages[w->stage + 1] : NULL;
+    bq_item_t item;
+
+    while (bq_get(&st->queue, &item, NULL) == 0) {
+        int out;
+        uint64_t start = monotonic_ns();
+        int forward_item = st->spec.fn(st->spec.arg, w->id, item.num, &out);
+        __atomic_fetch_add(&st->busy_ns, monotonic_ns() - start, __ATOMIC_RELAXED);
+        if (!forward_item || next == NULL) continue;
+        bq_item_t forward = { out, 0 };
+        // Cannot fail: the next queue is closed only after this stage's workers have all exited.
+        bq_put(&next->queue, forward, NULL);
+    }
+
+    if (__atomic_sub_fetch(&st->active, 1, __ATOMIC_ACQ_REL) == 0 && next != NULL) {
+        bq_close(&next->queue);
+    }
+    return NULL;
+}
+
+/*
+* Build the pipeline and start every stage's workers.
+* input - stages: stage descriptions, num_stages: how many,
+*         capacity: slots in each stage's input queue, wait: wait strategy for every queue
+* output - the pipeline, or NULL if a stage has no workers, allocation fails
+*          or a worker thread cannot be started
+*/
+pipeline_t *pipeline_create(const pipeline_stage_t *stages, int num_stages, int capacity, wait_strategy_t wait) {
+    if (num_stages < 1) return NULL;
+    for (int s = 0; s < num_stages; s++) {
+        if (stages[s].num_workers < 1) return NULL; // Nobody would drain or close past this stage.
+    }
+
+    pipeline_t *p = calloc(1, sizeof(pipeline_t));
+    if (p == NULL) return NULL;
+    pthread_mutex_init(&p->monitor_lock, NULL);
+    pthread_cond_init(&p->monitor_cond, NULL);
+    p->stages = calloc((size_t)num_stages, sizeof(stage_t));
+    if (p->stages == NULL) {
+        pipeline_destroy(p);
+        return NULL;
+    }
+
+    // Set up every queue before any thread starts so workers never see a half-built pipeline.
+    for (int s = 0; s < num_stages; s++) {
+        stage_t *st = &p->stages[s];
+        st->spec = stages[s];
+        st->active = stages[s].num_workers;
+        st->threads = malloc((size_t)stages[s].num_workers * sizeof(pthread_t));
+        st->workers = malloc((size_t)stages[s].num_workers * sizeof(stage_worker_t));
+        if (st->threads == NULL || st->workers == NULL || bq_init(&st->queue, capacity, wait) != 0) {
+            p->num_stages = s + 1;
+            pipeline_destroy(p);
+            return NULL;
+        }
+    }
+    p->num_stages = num_stages;
+    p->start_ns = monotonic_ns();
+
+    for (int s = 0; s < num_stages; s++) {
+        stage_t *st = &p->stages[s];
+        for (int i = 0; i < st->spec.num_workers; i++) {
+            st->workers[i].p = p;
+            st->workers[i].stage = s;
+            st->workers[i].id = i;
+            if (pthread_create(&st->threads[i], NULL, stage_worker, &st->workers[i]) != 0) {
+                // Every queue is still empty, so closing them all makes the started workers exit.
+                for (int c = 0; c < num_stages; c++) bq_close(&p->stages[c].queue);
+                for (int done = 0; done <= s; done++) {
+                    int started = done < s ? p->stages[done].spec.num_workers : i;
+                    for (int j = 0; j < started; j++) pthread_join(p->stages[done].threads[j], NULL);
+                }
+                pipeline_destroy(p);
+                return NULL;
+            }
+        }
+    }
+    return p;
+}
+
+/*
+* Feed one number into stage 0, waiting while its queue is full.
+* input - p: the pipeline, num: the number,
+*         wait_cpu_ns: if not NULL, thread CPU time spent waiting is added here
+* output - 0 on success, -1 if the pipeline was already closed
+*/
+int pipeline_put(pipeline_t *p, int num, uint64_t *wait_cpu_ns) {
+    bq_item_t item = { num, 0 };
+    return bq_put(&p->stages[0].queue, item, wait_cpu_ns);
+}
+
+/*
+* Signal that no more input is coming. Call once every master is done.
+* input - p: the pipeline
+* output - none
+*/
+void pipeline_close(pipeline_t *p) {
+    bq_close(&p->stages[0].queue);
+}
+
+/*
+* Wait for every stage to drain and its workers to exit, then stop the
+* monitor if one is running.
+* input - p: the pipeline, after pipeline_close()
+* output - none
+*/
+void pipeline_join(pipeline_t *p) {
+    for (int s = 0; s < p->num_stages; s++) {
+        for (int i = 0; i < p->stages[s].spec.num_workers; i++) {
+            pthread_join(p->stages[s].threads[i], NULL);
+        }
+    }
+
+    if (p->monitoring) {
+        pthread_mutex_lock(&p->monitor_lock);
+        p->stop_monitor = 1;
+        pthread_cond_signal(&p->monitor_cond);
+        pthread_mutex_unlock(&p->monitor_lock);
+        pthread_join(p->monitor, NULL);
+        p->monitoring = 0;
+    }
+}
+
+/*
+* Free the pipeline. Its workers must have been joined.
+* input - p: the pipeline
+* output - none
+*/
+void pipeline_destroy(pipeline_t *p) {
+    for (int s = 0; s < p->num_stages; s++) {
+        if (p->stages[s].queue.slots) bq_destroy(&p->stages[s].queue);
+        free(p->stages[s].threads);
+        free(p->stages[s].workers);
+    }
+    free(p->stages);
+    pthread_cond_destroy(&p->monitor_cond);
+    pthread_mutex_destroy(&p->monitor_lock);
+    free(p);
+}
+
+/*
+* Print depth, stall and utilization figures for every stage.
+* "full" is time upstream spent blocked on the stage's input queue and
+* "empty" is time its workers spent starved. put-wait/get-wait count
+* threads blocked on that queue right now. Backpressure cascades, so every
+* stage upstream of a slow one shows full stalls; the slow stage is the
+* one whose workers are busiest, which is the one named.
+* input - p: the pipeline (may still be running), out: where to print
+* output - none
+*/
+void pipeline_report(pipeline_t *p, FILE *out) {
+    int slowest = -1;
+    double slowest_busy = 0.0;
+    double elapsed_ns = (double)(monotonic_ns() - p->start_ns);
+
+    fprintf(out, "%-5s %-12s %7s %5s %5s %9s %10s %11s %9s %12s %9s %8s %8s %6s\n",
+            "stage", "name", "workers", "depth", "max", "avg-depth", "items",
+            "full-stalls", "full(ms)", "empty-stalls", "empty(ms)", "put-wait", "get-wait", "busy%");
+    for (int s = 0; s < p->num_stages; s++) {
+        stage_t *st = &p->stages[s];
+        bq_stats_t stats;
+        int depth;
+        bq_stats(&st->queue, &stats, &depth);
+
+        double busy = elapsed_ns > 0
+            ? 100.0 * (double)__atomic_load_n(&st->busy_ns, __ATOMIC_RELAXED) / (elapsed_ns * st->spec.num_workers)
+            : 0.0;
+        fprintf(out, "%5d %-12s %7d %5d %5d %9.1f %10llu %11llu %9.1f %12llu %9.1f %8d %8d %6.1f\n",
+                s, st->spec.name, st->spec.num_workers, depth, stats.max_depth,
+                stats.puts ? (double)stats.depth_sum / (double)stats.puts : 0.0,
+                (unsigned long long)stats.gets,
+                (unsigned long long)stats.full_stalls, stats.full_stall_ns / 1e6,
+                (unsigned long long)stats.empty_stalls, stats.empty_stall_ns / 1e6,
+                stats.putters_waiting, stats.getters_waiting, busy);
+        if (busy > slowest_busy) {
+            slowest_busy = busy;
+            slowest = s;
+        }
+    }
+    if (slowest >= 0) {
+        fprintf(out, "bottleneck: stage %d (%s), workers busy %.1f%% of the time\n",
+                slowest, p->stages[slowest].spec.name, slowest_busy);
+    }
+    fflush(out);
+}
+
+static void* monitor_thread(void *arg) {
+    pipeline_t *p = arg;
+
+    pthread_mutex_lock(&p->monitor_lock);
+    while (!p->stop_monitor) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        uint64_t nsec = (uint64_t)deadline.tv_nsec + (uint64_t)p->monitor_interval_ms * 1000000u;
+        deadline.tv_sec += (time_t)(nsec / 1000000000u);
+        deadline.tv_nsec = (long)(nsec % 1000000000u);
+
+        int rc = 0;
+        while (!p->stop_monitor && rc != ETIMEDOUT) {
+            rc = pthread_cond_timedwait(&p->monitor_cond, &p->monitor_lock, &deadline);
+        }
+        if (p->stop_monitor) break;
+
+        pthread_mutex_unlock(&p->monitor_lock);
+        pipeline_report(p, p->monitor_out);
+        pthread_mutex_lock(&p->monitor_lock);
+    }
+    pthread_mutex_unlock(&p->monitor_lock);
+    return NULL;
+}
+
+/*
+* Print pipeline_report() every interval_ms until pipeline_join() returns.
+* input - p: the pipeline, interval_ms: time between reports, out: where to print
+* output - 0 on success, -1 if the monitor thread could not be started
+*/
+int pipeline_start_monitor(pipeline_t *p, int interval_ms, FILE *out) {
+    if (p->monitoring || interval_ms <= 0) return -1;
+    p->monitor_interval_ms = interval_ms;
+    p->monitor_out = out;
+    p->stop_monitor = 0;
+    if (pthread_create(&p->monitor, NULL, monitor_thread, p) != 0) return -1;
+    p->monitoring = 1;
+    return 0;
+}
@@ -0,0 +1,47 @@
+/*********************************************************************
+* Multi-stage master-worker pipeline.
+*
+* Masters feed stage 0 with pipeline_put(). Each stage has its own pool of
+* worker threads and a bounded input queue; the workers of stage N are the
+* producers of stage N+1, so a slow stage fills its input queue and
+* blocks everything upstream (backpressure).
+*
+* Shutdown is explicit. pipeline_close() closes stage 0's queue once the
+* masters are done. Each stage drains its queue, and the last worker of a
+* stage to finish closes the next stage's queue. pipeline_join() returns
+* only after every item has gone through every stage.
+**********************************************************************/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdio.h>
+
+#include "bqueue.h"
+
+/*
+* Work done by one stage on one item.
+* input - arg: the stage's arg, worker_id: worker number within the stage,
+*         in: the item, out: where to store the item for the next stage
+* output - nonzero to pass *out downstream, 0 to drop the item
+*/
+typedef int (*pipeline_fn_t)(void *arg, int worker_id, int in, int *out);
+
+typedef struct {
+    const char *name;  // Shown in reports.
+    int num_workers;
+    pipeline_fn_t fn;
+    void *arg;
+} pipeline_stage_t;
+
+typedef struct pipeline pipeline_t;
+
+pipeline_t *pipeline_create(const pipeline_stage_t *stages, int num_stages, int capacity, wait_strategy_t wait);
+int pipeline_put(pipeline_t *p, int num, uint64_t *wait_cpu_ns);
+void pipeline_close(pipeline_t *p);
+void pipeline_join(pipeline_t *p);
+void pipeline_destroy(pipeline_t *p);
+void pipeline_report(pipeline_t *p, FILE *out);
+int pipeline_start_monitor(pipeline_t *p, int interval_ms, FILE *out);
+
+#endif
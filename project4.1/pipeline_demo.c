@@ -0,0 +1,167 @@
+/*********************************************************************
+* Multi-stage pipeline driver.
+*
+* Usage: main --pipeline [-w wait] [-i ms] <M> <N> <P> <stage>...
+*   M      - numbers 0..M-1 produced by the masters
+*   N      - size of each stage's input queue
+*   P      - number of master threads
+*   stage  - workers[:work], e.g. 2:1000 is two workers that each spin
+*            1000 iterations per item
+*   -w     - wait strategy for every queue: spin, sleep or block (default)
+*   -i     - print the per-stage report every ms milliseconds while running
+*
+* The last stage checks that each number 0..M-1 arrives exactly once.
+**********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "pipeline.h"
+#include "pipeline_demo.h"
+
+#define MAX_STAGES 16
+
+typedef struct {
+    int work;            // Busy-loop iterations per item.
+    int num_items;       // M, for the exactly-once check.
+    unsigned char *seen; // Last stage only: times each number arrived.
+} demo_stage_t;
+
+typedef struct {
+    pipeline_t *pipeline;
+    int num_items;
+    int next_number; // Next number a master will produce.
+} demo_source_t;
+
+/*
+* Stage function: burn some CPU, then pass the number on unchanged. The
+* last stage records the number instead.
+* input - see pipeline_fn_t
+* output - 1 to forward the item
+*/
+static int demo_stage_fn(void *arg, int worker_id, int in, int *out) {
+    demo_stage_t *stage = arg;
+    volatile unsigned sink = (unsigned)in;
+    (void)worker_id;
+
+    for (int i = 0; i < stage->work; i++) sink = sink * 31u + (unsigned)i;
+
+    if (stage->seen) {
+        if (in >= 0 && in < stage->num_items) __atomic_fetch_add(&stage->seen[in], 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    *out = in;
+    return 1;
+}
+
+static void* demo_master(void *arg) {
+    demo_source_t *src = arg;
+    int num;
+
+    while ((num = __atomic_fetch_add(&src->next_number, 1, __ATOMIC_RELAXED)) < src->num_items) {
+        if (pipeline_put(src->pipeline, num, NULL) != 0) break; // Closed under us; nothing more to do.
+    }
+    return NULL;
+}
+
+static void pipeline_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s --pipeline [-w spin|sleep|block] [-i ms] <M> <N> <P> <workers[:work]>...\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+/*
+* Entry point for "main --pipeline ...".
+* input - argc, argv: the full command line, argv[1] is "--pipeline"
+* output - 0 if every number went through every stage exactly once
+*/
+int pipeline_demo_main(int argc, char *argv[]) {
+    wait_strategy_t wait = WAIT_BLOCK;
+    int interval_ms = 0, opt;
+
+    optind = 2; // Skip the program name and "--pipeline".
+    while ((opt = getopt(argc, argv, "w:i:")) != -1) {
+        switch (opt) {
+        case 'w': if (wait_strategy_parse(optarg, &wait) != 0) pipeline_usage(argv[0]); break;
+        case 'i': interval_ms = atoi(optarg); break;
+        default: pipeline_usage(argv[0]);
+        }
+    }
+    int num_stages = argc - optind - 3;
+    if (num_stages < 1 || num_stages > MAX_STAGES) pipeline_usage(argv[0]);
+
+    int num_items = atoi(argv[optind]);
+    int buffer_size = atoi(argv[optind + 1]);
+    int num_masters = atoi(argv[optind + 2]);
+    if (num_items <= 0 || buffer_size <= 0 || num_masters <= 0) pipeline_usage(argv[0]);
+
+    unsigned char *seen = calloc((size_t)num_items, 1);
+    if (seen == NULL) {
+        fprintf(stderr, "Failed to allocate memory for the check\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pipeline_stage_t stages[MAX_STAGES];
+    demo_stage_t demo[MAX_STAGES];
+    char names[MAX_STAGES][16];
+    for (int s = 0; s < num_stages; s++) {
+        char *end;
+        const char *spec = argv[optind + 3 + s];
+        stages[s].num_workers = (int)strtol(spec, &end, 10);
+        demo[s].work = *end == ':' ? atoi(end + 1) : 0;
+        demo[s].num_items = num_items;
+        demo[s].seen = s == num_stages - 1 ? seen : NULL;
+        if (stages[s].num_workers <= 0 || (*end != ':' && *end != '\0')) pipeline_usage(argv[0]);
+
+        snprintf(names[s], sizeof(names[s]), "stage%d", s);
+        stages[s].name = names[s];
+        stages[s].fn = demo_stage_fn;
+        stages[s].arg = &demo[s];
+    }
+
+    pipeline_t *pipeline = pipeline_create(stages, num_stages, buffer_size, wait);
+    if (pipeline == NULL) {
+        fprintf(stderr, "Failed to create pipeline\n");
+        exit(EXIT_FAILURE);
+    }
+    if (interval_ms > 0) pipeline_start_monitor(pipeline, interval_ms, stdout);
+
+    demo_source_t src = { pipeline, num_items, 0 };
+    pthread_t master_threads[num_masters];
+    uint64_t start_ns = monotonic_ns();
+    for (int i = 0; i < num_masters; i++) {
+        if (pthread_create(&master_threads[i], NULL, demo_master, &src) != 0) {
+            fprintf(stderr, "Failed to create master thread %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int i = 0; i < num_masters; i++) {
+        pthread_join(master_threads[i], NULL);
+    }
+
+    // Every master is done: close the input and let the stages drain in order.
+    pipeline_close(pipeline);
+    pipeline_join(pipeline);
+    double seconds = (monotonic_ns() - start_ns) / 1e9;
+
+    pipeline_report(pipeline, stdout);
+    pipeline_destroy(pipeline);
+
+    int missing = 0, duplicated = 0;
+    for (int i = 0; i < num_items; i++) {
+        if (seen[i] == 0) missing++;
+        else if (seen[i] > 1) duplicated++;
+    }
+    free(seen);
+
+    printf("%d items through %d stage(s) in %.3f s (%.0f items/s, wait %s)\n",
+           num_items, num_stages, seconds, seconds > 0 ? num_items / seconds : 0.0, wait_strategy_name(wait));
+    if (missing || duplicated) {
+        printf("check: FAIL (missing=%d dup=%d)\n", missing, duplicated);
+        return EXIT_FAILURE;
+    }
+    printf("check: ok\n");
+    return 0;
+}
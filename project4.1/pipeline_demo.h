@@ -0,0 +1,14 @@
+/*********************************************************************
+* Pipeline mode for the master-worker program.
+*
+* Runs masters into a multi-stage pipeline whose stages do a configurable
+* amount of synthetic work, printing per-stage depth and stall metrics so
+* the slow stage can be found while the pipeline is running.
+**********************************************************************/
+
+#ifndef PIPELINE_DEMO_H
+#define PIPELINE_DEMO_H
+
+int pipeline_demo_main(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,135 @@
+/*********************************************************************
+* Topology-aware sharded queue. See shardq.h for the idea.
+**********************************************************************/
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "shardq.h"
+
+#define SHARD_BLOCK_POLL_NS 50000 // How long a blocking worker sleeps before re-polling remote shards.
+#define SHARD_HEADER_SIZE ((sizeof(bqueue_t) + 63) & ~(size_t)63) // Slots start on their own cache line.
+
+/*
+* Create one shard per CPU group. Each shard gets a fresh anonymous
+* mapping holding its queue header and slots. The mapping is faulted in
+* while the calling thread runs on that group, so the kernel's first-touch
+* policy places the lock, counters and slots on the group's node.
+* input - sq: queue to set up, topo: CPU groups,
+*         capacity: total slots, split over the shards so they add up to exactly capacity,
+*         wait: wait strategy for every shard
+* output - 0 on success, -1 if capacity is below the number of groups or allocation fails
+*/
+int shardq_init(shardq_t *sq, const topology_t *topo, int capacity, wait_strategy_t wait) {
+    cpu_set_t saved;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+
+    if (capacity < topo->num_groups) return -1; // Every shard needs at least one slot.
+    sq->num_shards = topo->num_groups;
+    sq->closed = 0;
+    sq->wait = wait;
+    sq->shards = calloc((size_t)sq->num_shards, sizeof(shard_t));
+    if (sq->shards == NULL) return -1;
+
+    int ok = 1;
+    pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved);
+    for (int g = 0; g < sq->num_shards && ok; g++) {
+        shard_t *shard = &sq->shards[g];
+        // The first capacity % num_shards shards take one extra slot.
+        int per_shard = capacity / sq->num_shards + (g < capacity % sq->num_shards ? 1 : 0);
+        size_t size = SHARD_HEADER_SIZE + (size_t)per_shard * sizeof(bq_item_t);
+        shard->map_size = (size + page - 1) / page * page;
+
+        // mmap never hands back pages that were already faulted in elsewhere, unlike malloc.
+        void *mem = mmap(NULL, shard->map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+            ok = 0;
+            break;
+        }
+        topology_pin_group(topo, g);
+        memset(mem, 0, shard->map_size); // First touch, from this group.
+        shard->queue = mem;
+        bq_init_slots(shard->queue, (bq_item_t *)((char *)mem + SHARD_HEADER_SIZE), per_shard, wait);
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+
+    if (!ok) {
+        shardq_destroy(sq);
+        return -1;
+    }
+    return 0;
+}
+
+void shardq_destroy(shardq_t *sq) {
+    for (int g = 0; g < sq->num_shards; g++) {
+        if (sq->shards[g].queue == NULL) continue;
+        bq_destroy(sq->shards[g].queue);
+        munmap(sq->shards[g].queue, sq->shards[g].map_size);
+    }
+    free(sq->shards);
+    sq->shards = NULL;
+}
+
+/*
+* Insert an item, preferring the local shard. If every shard is full the
+* thread waits on its local shard.
+* input - sq: the queue, home: the caller's shard, item: the item,
+*         wait_cpu_ns: if not NULL, thread CPU time spent waiting is added here
+* output - 0 if inserted, -1 if the queue is closed
+*/
+int shardq_put(shardq_t *sq, int home, bq_item_t item, uint64_t *wait_cpu_ns) {
+    for (int i = 0; i < sq->num_shards; i++) {
+        if (bq_try_put(sq->shards[(home + i) % sq->num_shards].queue, item) == 0) return 0;
+    }
+    return bq_put(sq->shards[home].queue, item, wait_cpu_ns);
+}
+
+/*
+* Remove an item, preferring the local shard and falling back to remote
+* shards in order. Waits with the queue's strategy while all are empty.
+* input - sq: the queue, home: the caller's shard, item: receives the removed item,
+*         wait_cpu_ns: if not NULL, thread CPU time spent waiting is added here,
+*         remote_gets: if not NULL, incremented when the item came from another shard
+* output - 0 if an item was removed, -1 if the queue is closed and every shard drained
+*/
+int shardq_get(shardq_t *sq, int home, bq_item_t *item, uint64_t *wait_cpu_ns, uint64_t *remote_gets) {
+    uint64_t start = 0;
+    int spins = 0;
+
+    for (int polls = 0; ; polls++) {
+        // Read the flag before sweeping: if it was already set, every put happened before the sweep.
+        int closed = __atomic_load_n(&sq->closed, __ATOMIC_ACQUIRE);
+        for (int i = 0; i < sq->num_shards; i++) {
+            if (bq_try_get(sq->shards[(home + i) % sq->num_shards].queue, item) == 0) {
+                if (i != 0 && remote_gets) (*remote_gets)++;
+                if (polls > 0 && wait_cpu_ns) *wait_cpu_ns += thread_cpu_ns() - start;
+                return 0;
+            }
+        }
+        if (closed) {
+            if (polls > 0 && wait_cpu_ns) *wait_cpu_ns += thread_cpu_ns() - start;
+            return -1;
+        }
+        if (polls == 0 && wait_cpu_ns) start = thread_cpu_ns();
+
+        if (sq->wait == WAIT_BLOCK) bq_wait_nonempty(sq->shards[home].queue, SHARD_BLOCK_POLL_NS);
+        else wait_strategy_pause(sq->wait, &spins);
+    }
+}
+
+/*
+* Close every shard. Waiting putters fail, and getters drain all shards
+* before shardq_get returns -1.
+* input - sq: the queue
+* output - none
+*/
+void shardq_close(shardq_t *sq) {
+    for (int g = 0; g < sq->num_shards; g++) {
+        bq_close(sq->shards[g].queue);
+    }
+    __atomic_store_n(&sq->closed, 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,38 @@
+/*********************************************************************
+* Queue sharded by CPU group. Each group of cores (a NUMA node or socket,
+* see topology.h) owns one bounded queue. Threads put to and take from
+* their local shard first and only touch remote shards when the local one
+* is full or empty, so most lock and slot cache lines stay on one socket.
+* shardq_close() closes every shard; getters drain what is left and then
+* get -1, like bq_get.
+**********************************************************************/
+
+#ifndef SHARDQ_H
+#define SHARDQ_H
+
+#include <stdint.h>
+
+#include "bqueue.h"
+#include "topology.h"
+
+/* One shard. The queue header and its slots share a private mapping that
+   is faulted in from the shard's own group, so they sit on its node. */
+typedef struct {
+    bqueue_t *queue; // Start of the mapping; slots follow the header.
+    size_t map_size;
+} shard_t;
+
+typedef struct {
+    shard_t *shards;
+    int num_shards;
+    int closed; // Set by shardq_close() after every shard is closed.
+    wait_strategy_t wait;
+} shardq_t;
+
+int shardq_init(shardq_t *sq, const topology_t *topo, int capacity, wait_strategy_t wait);
+void shardq_destroy(shardq_t *sq);
+int shardq_put(shardq_t *sq, int home, bq_item_t item, uint64_t *wait_cpu_ns);
+int shardq_get(shardq_t *sq, int home, bq_item_t *item, uint64_t *wait_cpu_ns, uint64_t *remote_gets);
+void shardq_close(shardq_t *sq);
+
+#endif
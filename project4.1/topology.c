@@ -0,0 +1,155 @@
+/*********************************************************************
+* CPU topology discovery and thread pinning.
+* See topology.h for how CPUs are grouped.
+* links
+* https://www.kernel.org/doc/html/latest/admin-guide/cputopology.html
+* https://man7.org/linux/man-pages/man3/pthread_setaffinity_np.3.html
+**********************************************************************/
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "topology.h"
+
+/*
+* Read the first line of a small sysfs file.
+* input - path: file to read, buf: destination, size: size of buf
+* output - 0 on success, -1 if the file could not be read
+*/
+static int read_line(const char *path, char *buf, size_t size) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return -1;
+    char *ok = fgets(buf, (int)size, f);
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+/*
+* Parse a kernel cpulist such as "0-3,8,10-11".
+* input - s: the list, set: CPUs found are added here
+* output - none
+*/
+static void parse_cpulist(const char *s, cpu_set_t *set) {
+    while (*s) {
+        char *end;
+        long first = strtol(s, &end, 10);
+        if (end == s) break;
+        long last = first;
+        if (*end == '-') {
+            s = end + 1;
+            last = strtol(s, &end, 10);
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET((int)cpu, set);
+        }
+        if (*end != ',') break;
+        s = end + 1;
+    }
+}
+
+/*
+* Append the usable CPUs of one group.
+* input - topo: topology being built, group_cpus: CPUs in the group,
+*         allowed: process affinity mask
+* output - none; empty groups are dropped
+*/
+static void add_group(topology_t *topo, const cpu_set_t *group_cpus, const cpu_set_t *allowed) {
+    if (topo->num_groups == TOPO_MAX_GROUPS) return;
+    int g = topo->num_groups;
+    topo->group_start[g] = topo->num_cpus;
+    topo->group_size[g] = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE && topo->num_cpus < TOPO_MAX_CPUS; cpu++) {
+        if (CPU_ISSET(cpu, group_cpus) && CPU_ISSET(cpu, allowed)) {
+            topo->cpus[topo->num_cpus++] = cpu;
+            topo->group_size[g]++;
+        }
+    }
+    if (topo->group_size[g] > 0) topo->num_groups++;
+}
+
+/*
+* Discover usable CPUs and group them by NUMA node or socket.
+* input - topo: filled in on return
+* output - 0 on success, -1 if the affinity mask could not be read
+*/
+int topology_read(topology_t *topo) {
+    cpu_set_t allowed, group;
+    char path[128], line[4096];
+
+    memset(topo, 0, sizeof(*topo));
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return -1;
+
+    // NUMA nodes first; node numbers can be sparse so probe each one.
+    for (int node = 0; node < TOPO_MAX_GROUPS; node++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        if (read_line(path, line, sizeof(line)) != 0) continue;
+        CPU_ZERO(&group);
+        parse_cpulist(line, &group);
+        add_group(topo, &group, &allowed);
+    }
+
+    // No NUMA information: group by physical package instead.
+    if (topo->num_groups == 0) {
+        for (int package = 0; package < TOPO_MAX_GROUPS; package++) {
+            CPU_ZERO(&group);
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (!CPU_ISSET(cpu, &allowed)) continue;
+                snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+                if (read_line(path, line, sizeof(line)) == 0 && atoi(line) == package) CPU_SET(cpu, &group);
+            }
+            add_group(topo, &group, &allowed);
+        }
+    }
+
+    // Still nothing (sysfs not mounted): one group with every allowed CPU.
+    if (topo->num_groups == 0) add_group(topo, &allowed, &allowed);
+    return 0;
+}
+
+/*
+* Pick a CPU for the index-th thread of a role. Consecutive threads go to
+* different groups so every group gets its share of masters and workers.
+* Inside a group, CPUs are handed out from slots_used, which the caller
+* shares between roles, so masters and workers get distinct cores until
+* the group runs out.
+* input - topo: the topology, index: thread number within its role,
+*         slots_used: per-group count of CPUs handed out so far, start at 0,
+*         group: if not NULL, receives the group of the chosen CPU
+* output - the CPU number
+*/
+int topology_place(const topology_t *topo, int index, int *slots_used, int *group) {
+    int g = index % topo->num_groups;
+    int slot = slots_used[g]++ % topo->group_size[g];
+    if (group) *group = g;
+    return topo->cpus[topo->group_start[g] + slot];
+}
+
+/*
+* Pin the calling thread to a single CPU.
+* input - cpu: the CPU number
+* output - 0 on success, an error number otherwise
+*/
+int topology_pin_cpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/*
+* Restrict the calling thread to the CPUs of one group.
+* input - topo: the topology, group: group index
+* output - 0 on success, an error number otherwise
+*/
+int topology_pin_group(const topology_t *topo, int group) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int i = 0; i < topo->group_size[group]; i++) {
+        CPU_SET(topo->cpus[topo->group_start[group] + i], &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
@@ -0,0 +1,29 @@
+/*********************************************************************
+* CPU topology read from sysfs, used to pin master and worker threads
+* and to decide which queue shard is "local" to a thread.
+*
+* CPUs are grouped by NUMA node (/sys/devices/system/node), falling back
+* to physical package (socket) and then to a single group. Only CPUs in
+* the process affinity mask are used.
+**********************************************************************/
+
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#define TOPO_MAX_CPUS 1024
+#define TOPO_MAX_GROUPS 64
+
+typedef struct {
+    int num_cpus;
+    int cpus[TOPO_MAX_CPUS];           // Usable CPUs, ordered by group.
+    int num_groups;
+    int group_start[TOPO_MAX_GROUPS];  // Index into cpus[] of each group's first CPU.
+    int group_size[TOPO_MAX_GROUPS];   // Number of CPUs in each group.
+} topology_t;
+
+int topology_read(topology_t *topo);
+int topology_place(const topology_t *topo, int index, int *slots_used, int *group);
+int topology_pin_cpu(int cpu);
+int topology_pin_group(const topology_t *topo, int group);
+
+#endif